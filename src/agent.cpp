@@ -22,24 +22,43 @@
  *made prioritised minimising complexity by increasing modularity, and maximising a "results / time" ratio.
  */
  
+#include <dirent.h>
+#include <stdint.h>
 #include <string.h>
 #include <cstdio>
 #include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <queue>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "bounty.h"
 #include "pipe.h"
 
 #define map_size 80
-#define world_size map_size * 2 - 1 + 3
-#define world_center map_size + 2
+#define world_size (map_size * 2 - 1 + 3)
+#define world_center (map_size + 2)
+#define bidirectional_min_distance 16 // manhattan distance above which aStar searches from both ends
+#define plan_max_states 4000
+#define plan_max_kabooms 31
+#define explore_bias 2 // added to the distance when scoring exploration targets, favours nearby tiles
+#define render_access 1
+#define render_frontier 2
+#define render_path 4
 
-int   pipe_fd;
-FILE* in_stream;
-FILE* out_stream;
 /*
  * Transpose matrix
  * used for view management
@@ -137,6 +156,67 @@ Inventory::Inventory(){
 	kaboomCount = 0;
 }
 
+// Kinds of tile which behave the same for movement
+enum TileClass { tile_other, tile_land, tile_boat, tile_water, tile_tree, tile_wall, tile_classes };
+
+constexpr int tileClass(char tile) {
+	return tile == ' ' || tile == 'a' || tile == 'd' || tile == 'g' ? tile_land
+		: tile == 'B' ? tile_boat
+		: tile == '~' ? tile_water
+		: tile == 'T' ? tile_tree
+		: tile == '*' ? tile_wall
+		: tile_other;
+}
+
+// Rule for stepping from one tile onto an adjacent one
+struct Transition {
+	bool passable; // can be entered, possibly after using a bomb
+	char kabooms; // bombs needed to enter
+	char action; // move needed before stepping forward, 'c' = chop, 'b' = blast, 0 = none
+};
+
+constexpr Transition makeTransition(int from, int to, bool axe) {
+	return to == tile_land || to == tile_boat ? Transition{true, 0, 0}
+		: to == tile_water ? Transition{from == tile_water || from == tile_boat, 0, 0}
+		: to == tile_tree ? (axe ? Transition{true, 0, 'c'} : Transition{true, 1, 'b'})
+		: to == tile_wall ? Transition{true, 1, 'b'}
+		: Transition{false, 0, 0};
+}
+
+// Transitions for every (from, to, hasAxe), generated at compile time and shared by every search
+struct TransitionTable {
+	unsigned char classes[256]; // indexed by the tile as an unsigned byte, so unexpected bytes are tile_other
+	Transition rules[2][tile_classes][tile_classes];
+	
+	constexpr TransitionTable() : classes(), rules() {
+		for (int i = 0; i < 256; ++i) {
+			classes[i] = tileClass((char)i);
+		}
+		for (int axe = 0; axe < 2; ++axe) {
+			for (int from = 0; from < tile_classes; ++from) {
+				for (int to = 0; to < tile_classes; ++to) {
+					rules[axe][from][to] = makeTransition(from, to, axe);
+				}
+			}
+		}
+	}
+	
+	const Transition &get(char from, char to, bool axe) const { return rules[axe][classes[(unsigned char)from]][classes[(unsigned char)to]]; }
+	template <bool axe>
+	const Transition &get(char from, char to) const { return rules[axe][classes[(unsigned char)from]][classes[(unsigned char)to]]; }
+};
+
+constexpr TransitionTable transitions;
+
+template <bool axe>
+using HasAxe = std::integral_constant<bool, axe>;
+
+// Step of a global plan, either walk to (x, y) or blast the obstacle at (x, y)
+struct PlanStep {
+	bool blast;
+	int x, y;
+};
+
 class World {
 	Inventory inventory;
 	int posX, posY; // cartesian coordinates
@@ -144,25 +224,41 @@ class World {
 	int bombX, bombY;
 	char map[world_size][world_size];
 	char access[world_size][world_size]; // -1 = cannot access, x > 0 = can access with x # of bombs
+	unsigned char unknown[world_size][world_size]; // number of '?' tiles in the 5x5 view centred on each coordinate
+	int exploreX, exploreY; // current exploration target
 	bool boat;
 	int seenXMin, seenXMax, seenYMin, seenYMax; // rectangular bounds of visible area in cartesian coordinates
 	int aStarDestX, aStarDestY; // last aStar destination
 	std::vector<char> aStarCache; // for caching the shortest path to a given coordinate
+	bool planner, planDirty; // whether to use the global planner, and whether the map changed since the last plan
+	std::vector<PlanStep> plan; // remaining steps of the global plan, next step at the back
+	const std::atomic<bool> *cancelled; // set when searches should give up early, see StageRunner
+	
+	bool makePlan();
+	bool aStarSearch(int startX, int startY, int startDir, int destX, int destY, bool kaboom, std::vector<char> &path, int &endDir);
+	template <bool axe> bool aStarSearch(int startX, int startY, int startDir, int destX, int destY, bool kaboom, std::vector<char> &path, int &endDir);
+	bool aStarBidirectional(int startX, int startY, int startDir, int destX, int destY, bool kaboom, std::vector<char> &path, int &endDir);
+	template <bool axe> bool aStarBidirectional(int startX, int startY, int startDir, int destX, int destY, bool kaboom, std::vector<char> &path, int &endDir);
 public:
 	static const int forwardX[4];
 	static const int forwardY[4];
-	static bool canWalk(char tile) { return (tile == ' ' || tile == 'a' || tile == 'd' || tile == 'B' || tile == 'g'); }
 	
 	World();
 	void updateMap(char (&view)[5][5]);
+	void predictView(char (&view)[5][5]) const;
+	bool matchesView(const char (&view)[5][5]) const;
 	void evalAccess();
+	void reveal(int i, int j);
+	template <bool axe> void evalAccess();
 	void move(char command);
 	char aStar(int destX, int destY, bool kaboom = false);
 	char explore();
 	char findInterest();
 	char bomb();
 	int bombVal(int i, int j);
+	template <bool axe> int bombVal(int i, int j);
 	char findTile(char target);
+	char followPlan();
 	void print() const;
 	
 	char getFront() const { return map[posX + forwardX[direction] + world_center][posY + forwardY[direction] + world_center]; }
@@ -171,24 +267,29 @@ public:
 		
 	int getPositionX() const { return posX; }
 	int getPositionY() const { return posY; }
+	int getDirection() const { return direction; }
+	int getSeenXMin() const { return seenXMin; }
+	int getSeenXMax() const { return seenXMax; }
+	int getSeenYMin() const { return seenYMin; }
+	int getSeenYMax() const { return seenYMax; }
+	const std::vector<char> &getPlannedPath() const { return aStarCache; } // next move at the back
 	int getVisibleWidth() const { return seenXMax - seenXMin; }
 	int getVisibleHeight() const { return seenYMax - seenYMin; }
 	
 	char getMap(int x, int y) const { return map[x + world_center][y + world_center]; }
 	bool canAccess(int x, int y, int kabooms) const { return access[x + world_center][y + world_center] != -1 && access[x + world_center][y + world_center] <= kabooms; }
 	int getAccess(int x, int y) const { return access[x + world_center][y + world_center]; }
-	bool isExplored(int x, int y) const {
-		for (int i = x + world_center - 2; i <= x + world_center + 2; ++i) {
-			for (int j = y + world_center - 2; j <= y + world_center + 2; ++j) {
-				if (map[i][j] == '?') {
-					return false;
-				}
-			}
-		}
-		return true;
-	}
+	int getUnknown(int x, int y) const { return unknown[x + world_center][y + world_center]; }
+	bool isExplored(int x, int y) const { return unknown[x + world_center][y + world_center] == 0; }
 	
 	void setBoat(bool boat) { this->boat = boat; }
+	void setPlanner(bool planner) { this->planner = planner; }
+	void setCancel(const std::atomic<bool> *cancelled) { this->cancelled = cancelled; }
+	bool isCancelled() const { return cancelled != NULL && cancelled->load(std::memory_order_relaxed); }
+	// carry over the state a failed stage leaves behind, see StageRunner
+	void adoptPlan(const World &other) { plan = other.plan; planDirty = other.planDirty; }
+	void adoptExploreTarget(const World &other) { exploreX = other.exploreX; exploreY = other.exploreY; }
+	bool usesPlanner() const { return planner; }
 	
 	bool hasAxe() const { return inventory.getAxe(); }
 	bool hasGold() const { return inventory.getGold(); }
@@ -205,8 +306,12 @@ World::World() {
 	posY = 0;
 	direction = 0; // starts facing north
 	bombX = 9001;
+	exploreX = 9001;
 	
 	boat = false;
+	planner = false;
+	planDirty = true;
+	cancelled = NULL;
 	
 	seenXMin = 0;
 	seenXMax = 0;
@@ -217,6 +322,7 @@ World::World() {
 		for (int j = 0; j < world_size; ++j) {
 			map[i][j] = '?';
 			access[i][j] = -1;
+			unknown[i][j] = (std::min(i, 2) + std::min(world_size - 1 - i, 2) + 1) * (std::min(j, 2) + std::min(world_size - 1 - j, 2) + 1);
 		}
 	}
 }
@@ -249,12 +355,14 @@ void World::updateMap(char (&view)[5][5]) {
 		for (int j = 0; j < 5; ++j) {
 			if (!(i == 2 && j == 2) && map[x + j][y - i] != view[i][j]) {
 				recheck = true;
+				if (map[x + j][y - i] == '?') reveal(x + j, y - i);
 				map[x + j][y - i] = view[i][j];
 			}
 		}
 	}
 	
 	// world map ignores player
+	if (map[posX + world_center][posY + world_center] == '?') reveal(posX + world_center, posY + world_center);
 	if (onBoat()) {
 		map[posX + world_center][posY + world_center] = 'B';
 	} else {
@@ -262,7 +370,52 @@ void World::updateMap(char (&view)[5][5]) {
 		map[posX + world_center][posY + world_center] = ' ';
 	}
 	
-	if (recheck) evalAccess();
+	if (recheck) {
+		evalAccess();
+		planDirty = true;
+	}
+}
+
+// an unknown tile (array coordinates) has been seen, so it no longer counts towards the views around it
+void World::reveal(int i, int j) {
+	for (int x = std::max(i - 2, 0); x <= std::min(i + 2, world_size - 1); ++x) {
+		for (int y = std::max(j - 2, 0); y <= std::min(j + 2, world_size - 1); ++y) {
+			--unknown[x][y];
+		}
+	}
+}
+
+// Builds the view the server would send if nothing new is revealed, in the same orientation as updateMap receives it
+void World::predictView(char (&view)[5][5]) const {
+	int x = posX + world_center - 2;
+	int y = posY + world_center + 2;
+	for (int i = 0; i < 5; ++i) {
+		for (int j = 0; j < 5; ++j) {
+			view[i][j] = map[x + j][y - i];
+		}
+	}
+	view[2][2] = '^';
+	
+	// Undo the rotation which updateMap applies
+	if (direction == 1) {
+		rotateCCW(view);
+	} else if (direction == 2) {
+		rotate180(view);
+	} else if (direction == 3) {
+		rotateCW(view);
+	}
+}
+
+// Whether a received view shows exactly what the map already holds around the player
+bool World::matchesView(const char (&view)[5][5]) const {
+	char predicted[5][5];
+	predictView(predicted);
+	for (int i = 0; i < 5; ++i) {
+		for (int j = 0; j < 5; ++j) {
+			if (!(i == 2 && j == 2) && predicted[i][j] != view[i][j]) return false;
+		}
+	}
+	return true;
 }
 
 struct Coord {
@@ -289,6 +442,12 @@ struct Coord {
 };
 
 // evaluates the accessability of each map coordinate
+void World::evalAccess() {
+	if (hasAxe()) evalAccess<true>();
+	else evalAccess<false>();
+}
+
+template <bool axe>
 void World::evalAccess() {
 	// BFS
 	std::vector<Coord> closed;
@@ -311,11 +470,9 @@ void World::evalAccess() {
 			char newTile = map[newX][newY];
 			
 			// check if coordinate is accessable
-			if (canWalk(newTile)
-				|| (newTile == '~' && (currTile == '~' || currTile == 'B'))
-				|| (newTile == 'T')
-				|| newTile == '*') {
-				Coord newCoord(newX, newY, current.kabooms + (newTile == '*' || (newTile == 'T' && !hasAxe()) ? 1 : 0));
+			const Transition &rule = transitions.get<axe>(currTile, newTile);
+			if (rule.passable) {
+				Coord newCoord(newX, newY, current.kabooms + rule.kabooms);
 				// check if in closed set
 				std::vector<Coord>::iterator iter;
 				for (iter = closed.begin(); iter != closed.end(); ++iter) {
@@ -362,6 +519,20 @@ void World::move(char command) {
 	}
 }
 
+// Lower bound on moves from (x, y) facing direction to (destX, destY)
+// Needs a turn unless already in line with the destination and facing it
+int estimateMoves(int x, int y, int direction, int destX, int destY) {
+	int dX = destX - x;
+	int dY = destY - y;
+	if (x != destX && y != destY) {
+		return (dX < 0 ? -dX : dX) + (dY < 0 ? -dY : dY) + 1;
+	} else if (x == destX) {
+		return (dX < 0 ? -dX : dX) + (dY < 0 ? -dY : dY) + ((dY == 0) || (dY > 0 && direction == 0) || (dY < 0 && direction == 2) ? 0 : 1);
+	} else {
+		return (dX < 0 ? -dX : dX) + (dY < 0 ? -dY : dY) + ((dX > 0 && direction == 1) || (dX < 0 && direction == 3) ? 0 : 1);
+	}
+}
+
 // Subclass for aStar
 class aStarNode {
 public:
@@ -379,7 +550,8 @@ public:
 	}
 	
 	// Constructor which emulates move
-	aStarNode(const aStarNode &old, const World &world, const char move) {
+	template <bool axe>
+	aStarNode(const aStarNode &old, const World &world, const char move, HasAxe<axe>) {
 		posX = old.posX;
 		posY = old.posY;
 		direction = old.direction;	
@@ -391,8 +563,9 @@ public:
 			bool canAccess = world.canAccess(posX + world.forwardX[direction], posY + world.forwardY[direction], 0);
 			char on = world.getMap(posX, posY);
 			char front = world.getMap(posX + world.forwardX[direction], posY + world.forwardY[direction]);
-			if (canAccess && !(front == '~' && (on == ' ' || on == 'T' || on == '*' || on == 'a' || on == 'd' || on == 'g'))) {
-				if (front == 'T') path.push_back('c');
+			const Transition &rule = transitions.get<axe>(on, front);
+			if (canAccess && rule.passable && rule.kabooms == 0) {
+				if (rule.action) path.push_back(rule.action);
 				posX += world.forwardX[direction];
 				posY += world.forwardY[direction];	
 			}
@@ -406,15 +579,7 @@ public:
 	
 	// Estimates cost to destination
 	int estimate() const {
-		int dX = destX - posX;
-		int dY = destY - posY;
-		if (posX != destX && posY != destY) {
-			return (dX < 0 ? -dX : dX) + (dY < 0 ? -dY : dY) + 1;
-		} else if (posX == destX) {
-			return (dX < 0 ? -dX : dX) + (dY < 0 ? -dY : dY) + ((dY == 0) || (dY > 0 && direction == 0) || (dY < 0 && direction == 2) ? 0 : 1);
-		} else {
-			return (dX < 0 ? -dX : dX) + (dY < 0 ? -dY : dY) + ((dX > 0 && direction == 1) || (dX < 0 && direction == 3) ? 0 : 1);
-		}
+		return estimateMoves(posX, posY, direction, destX, destY);
 	}
 	
 	// Overrides
@@ -454,27 +619,59 @@ char World::aStar(int destX, int destY, bool kaboom) {
 		return 0;
 	}
 	
+	std::vector<char> path;
+	int endDir = direction;
+	
+	// Long trips are searched from both ends
+	int dX = destX - posX;
+	int dY = destY - posY;
+	int distance = (dX < 0 ? -dX : dX) + (dY < 0 ? -dY : dY);
+	if (distance > bidirectional_min_distance) {
+		aStarBidirectional(posX, posY, direction, destX, destY, kaboom, path, endDir);
+	}
+	
+	// Otherwise (or if that failed) search the map directly
+	if (path.empty()) {
+		if (!aStarSearch(posX, posY, direction, destX, destY, kaboom, path, endDir) || path.empty()) {
+			return 0;
+		}
+	}
+	
+	// Update cache
+	aStarDestX = destX;
+	aStarDestY = destY;
+	char move = path.front();
+	std::reverse(path.begin(), path.end());
+	path.pop_back();
+	aStarCache = path;
+	return move;
+}
+
+// A* from an arbitrary position and direction, appends the moves to path
+// If kaboom, stops facing the destination and appends the bomb move
+bool World::aStarSearch(int startX, int startY, int startDir, int destX, int destY, bool kaboom, std::vector<char> &path, int &endDir) {
+	if (hasAxe()) return aStarSearch<true>(startX, startY, startDir, destX, destY, kaboom, path, endDir);
+	return aStarSearch<false>(startX, startY, startDir, destX, destY, kaboom, path, endDir);
+}
+
+template <bool axe>
+bool World::aStarSearch(int startX, int startY, int startDir, int destX, int destY, bool kaboom, std::vector<char> &path, int &endDir) {
 	// A* begin
 	std::vector<aStarNode> closed;
 	std::priority_queue<aStarNode, std::vector<aStarNode>, std::greater<aStarNode> > open;
-	aStarNode current(posX, posY, direction, destX, destY);
+	aStarNode current(startX, startY, startDir, destX, destY);
 	open.push(current);
 	
-	while (!open.empty()) {
+	while (!open.empty() && !isCancelled()) {
 		current = open.top();
 		
 		// At destination/bombsite
 		if (current.estimate() == 0 || (kaboom && current.estimate() == 1)) {
-			// Update cache
-			aStarDestX = destX;
-			aStarDestY = destY;
 			// If bombing, then add bomb move
 			if (kaboom && getAccess(current.posX + forwardX[current.direction], current.posY + forwardY[current.direction]) > 0) current.path.push_back('b');
-			char move = current.path.front();
-			std::reverse(current.path.begin(), current.path.end());
-			current.path.pop_back();
-			aStarCache = current.path;
-			return move;
+			path.insert(path.end(), current.path.begin(), current.path.end());
+			endDir = current.direction;
+			return true;
 		}
 		
 		// Pop off open set and add to closed set
@@ -484,7 +681,7 @@ char World::aStar(int destX, int destY, bool kaboom) {
 		// Add neighbours (move forward, turn left/right)
 		char testMoves[3] = {'f', 'l', 'r'};
 		for (int i = 0; i < 3; ++i) {
-			aStarNode nextNode = aStarNode(current, *this, testMoves[i]);
+			aStarNode nextNode = aStarNode(current, *this, testMoves[i], HasAxe<axe>());
 			
 			// Check if in closed set
 			bool found = false;
@@ -500,56 +697,203 @@ char World::aStar(int destX, int destY, bool kaboom) {
 		}
 	}
 	
-	return 0;
-};
+	return false;
+}
+
+bool World::aStarBidirectional(int startX, int startY, int startDir, int destX, int destY, bool kaboom, std::vector<char> &path, int &endDir) {
+	if (hasAxe()) return aStarBidirectional<true>(startX, startY, startDir, destX, destY, kaboom, path, endDir);
+	return aStarBidirectional<false>(startX, startY, startDir, destX, destY, kaboom, path, endDir);
+}
 
 /*
- * determins the best moves to releave unknown areas of map
- * aims for closet tile to reveal 
+ * Bidirectional A*, searching forwards from the start and backwards from the destination until they meet
+ * States are (x, y, direction) so turns are costed both ways. The backward heuristic is the forward
+ * estimate for a walker retracing the path facing the other way, so both heuristics are consistent.
+ * Stops once the best meeting cost is no more than the lowest f in either queue, at which point no
+ * shorter path can remain, so the result is as short as aStarSearch would give.
+ */
+template <bool axe>
+bool World::aStarBidirectional(int startX, int startY, int startDir, int destX, int destY, bool kaboom, std::vector<char> &path, int &endDir) {
+	// states are indexed within the seen area, index = cell * 4 + direction
+	int width = seenXMax - seenXMin + 1;
+	int height = seenYMax - seenYMin + 1;
+	int states = width * height * 4;
+	if (startX < seenXMin || startX > seenXMax || startY < seenYMin || startY > seenYMax) return false;
+	
+	// 0 = forward, 1 = backward
+	// forward links point back towards the start with the move taken, backward links point on towards the goal
+	std::vector<int> g[2] = {std::vector<int>(states, INT_MAX), std::vector<int>(states, INT_MAX)};
+	std::vector<int> link[2] = {std::vector<int>(states, -1), std::vector<int>(states, -1)};
+	std::vector<char> linkMove[2] = {std::vector<char>(states, 0), std::vector<char>(states, 0)};
+	std::vector<bool> closed[2] = {std::vector<bool>(states, false), std::vector<bool>(states, false)};
+	std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int> >, std::greater<std::pair<int, int> > > open[2];
+	int best = INT_MAX, meet = -1;
+	
+	// forward heuristic to the goal (facing the destination if bombing), backward to the start
+	auto heuristic = [&](int side, int x, int y, int d) {
+		if (side == 1) return estimateMoves(x, y, (d + 2) % 4, startX, startY);
+		int estimate = estimateMoves(x, y, d, destX, destY);
+		return kaboom ? std::max(estimate - 1, 0) : estimate;
+	};
+	auto stateIndex = [&](int x, int y, int d) { return ((x - seenXMin) * height + y - seenYMin) * 4 + d; };
+	
+	// goal states: at the destination in any direction, or next to it and facing it when bombing
+	for (int d = 0; d < 4; ++d) {
+		int x = kaboom ? destX - forwardX[d] : destX;
+		int y = kaboom ? destY - forwardY[d] : destY;
+		if (!canAccess(x, y, 0) || x < seenXMin || x > seenXMax || y < seenYMin || y > seenYMax) continue;
+		int index = stateIndex(x, y, d);
+		g[1][index] = 0;
+		open[1].push(std::make_pair(heuristic(1, x, y, d), index));
+	}
+	int start = stateIndex(startX, startY, startDir);
+	g[0][start] = 0;
+	open[0].push(std::make_pair(heuristic(0, startX, startY, startDir), start));
+	if (g[1][start] == 0) {
+		best = 0;
+		meet = start;
+	}
+	
+	while (!isCancelled()) {
+		for (int side = 0; side < 2; ++side) {
+			while (!open[side].empty() && closed[side][open[side].top().second]) open[side].pop();
+		}
+		if (open[0].empty() || open[1].empty()) break;
+		if (best <= std::max(open[0].top().first, open[1].top().first)) break;
+		
+		// expand the smaller frontier
+		int side = open[0].size() <= open[1].size() ? 0 : 1;
+		int current = open[side].top().second;
+		open[side].pop();
+		closed[side][current] = true;
+		
+		int d = current % 4;
+		int x = current / 4 / height + seenXMin;
+		int y = current / 4 % height + seenYMin;
+		
+		// neighbours: turn left, turn right, and forward (or, backwards, the tile behind)
+		for (int i = 0; i < 3; ++i) {
+			int newX = x, newY = y, newD = d, cost = 1;
+			char move;
+			if (i == 0) {
+				move = 'l';
+				newD = side == 0 ? (d + 3) % 4 : (d + 1) % 4;
+			} else if (i == 1) {
+				move = 'r';
+				newD = side == 0 ? (d + 1) % 4 : (d + 3) % 4;
+			} else {
+				move = 'f';
+				int step = side == 0 ? 1 : -1;
+				newX = x + forwardX[d] * step;
+				newY = y + forwardY[d] * step;
+				if (!canAccess(newX, newY, 0)) continue;
+				int fromX = side == 0 ? x : newX, fromY = side == 0 ? y : newY;
+				int toX = side == 0 ? newX : x, toY = side == 0 ? newY : y;
+				const Transition &rule = transitions.get<axe>(getMap(fromX, fromY), getMap(toX, toY));
+				if (!rule.passable || rule.kabooms != 0) continue;
+				if (rule.action) cost = 2;
+			}
+			
+			int next = stateIndex(newX, newY, newD);
+			if (closed[side][next] || g[side][current] + cost >= g[side][next]) continue;
+			g[side][next] = g[side][current] + cost;
+			link[side][next] = current;
+			linkMove[side][next] = move;
+			open[side].push(std::make_pair(g[side][next] + heuristic(side, newX, newY, newD), next));
+			
+			// frontiers touch
+			if (g[1 - side][next] != INT_MAX && g[0][next] + g[1][next] < best) {
+				best = g[0][next] + g[1][next];
+				meet = next;
+			}
+		}
+	}
+	if (meet == -1) return false;
+	
+	// states from the start to the meeting state, then on to the goal
+	std::vector<int> sequence;
+	for (int i = meet; i != start; i = link[0][i]) sequence.push_back(i);
+	sequence.push_back(start);
+	std::reverse(sequence.begin(), sequence.end());
+	for (int i = meet; link[1][i] != -1; i = link[1][i]) sequence.push_back(link[1][i]);
+	
+	for (unsigned int i = 1; i < sequence.size(); ++i) {
+		int from = sequence[i - 1];
+		int to = sequence[i];
+		char move = link[0][to] == from ? linkMove[0][to] : linkMove[1][from];
+		if (move == 'f') {
+			int fromX = from / 4 / height + seenXMin, fromY = from / 4 % height + seenYMin;
+			int toX = to / 4 / height + seenXMin, toY = to / 4 % height + seenYMin;
+			char action = transitions.get<axe>(getMap(fromX, fromY), getMap(toX, toY)).action;
+			if (action) path.push_back(action);
+		}
+		path.push_back(move);
+	}
+	
+	// If bombing, then add bomb move
+	int goal = sequence.back();
+	endDir = goal % 4;
+	if (kaboom && getAccess(goal / 4 / height + seenXMin + forwardX[endDir], goal / 4 % height + seenYMin + forwardY[endDir]) > 0) path.push_back('b');
+	return true;
+}
+
+/*
+ * determines the best move to reveal unknown areas of the map
+ * one BFS finds the distance to every reachable tile, and the target is the tile revealing the most
+ * unknown tiles per move, kept until it is explored so the agent does not oscillate between targets
  */
 char World::explore() {
-	std::vector<Coord> closed;
+	// keep going to the previous target while it still reveals something
+	if (exploreX != 9001 && !isExplored(exploreX, exploreY)) {
+		char move = aStar(exploreX, exploreY);
+		if (move != 0) return move;
+	}
+	exploreX = 9001;
+	
+	std::vector<int> distance(world_size * world_size, -1);
+	std::vector<Coord> candidates; // kabooms unused
+	std::vector<int> scores;
 	std::queue<Coord> open;
 	
 	Coord current(posX, posY);
-	closed.push_back(current);
+	distance[(posX + world_center) * world_size + posY + world_center] = 0;
 	open.push(current);
-	//directions of movement arraged so once added to the queue the ones with least turns required
-	//will be sorted closer to front if tied with others
-	while (!open.empty()) {
+	while (!open.empty() && !isCancelled()) {
 		current = open.front();
-		// return condition of closet unexplored tile
+		open.pop();
+		int dist = distance[(current.x + world_center) * world_size + current.y + world_center];
+		
+		// unknown tiles revealed per move, scaled to keep precision
 		if (!isExplored(current.x, current.y)) {
-			char move = aStar(current.x, current.y);
-			if (move != 0) {
-				return move;
-			}
+			candidates.push_back(current);
+			scores.push_back(getUnknown(current.x, current.y) * 1024 / (dist + explore_bias));
 		}
-
-		open.pop();
+		
 		//eval adjacent tiles
 		for (int i = 0; i < 4; ++i) {
 			int newX = current.x + forwardX[i];
 			int newY = current.y + forwardY[i];
-			if (!canAccess(newX, newY, 0)) continue;
-			//reject unreachable tiles
-			Coord nextNode(newX, newY);
-			bool found = false;
-
-			for (std::vector<Coord>::iterator iter = closed.begin(); iter != closed.end(); ++iter) {
-				if (nextNode == *iter) {
-					found = true;
-					break;
-				}
-			}
-			//rejects evaluated tiles
-			if (!found) {
-				closed.push_back(nextNode);
-				open.push(nextNode);
-			}
+			int &newDist = distance[(newX + world_center) * world_size + newY + world_center];
+			//reject unreachable and evaluated tiles
+			if (newDist != -1 || !canAccess(newX, newY, 0)) continue;
+			newDist = dist + 1;
+			open.push(Coord(newX, newY));
 		}
 	}
 	
+	// best candidates first, ties broken by BFS order (nearest)
+	while (!candidates.empty() && !isCancelled()) {
+		int best = std::max_element(scores.begin(), scores.end()) - scores.begin();
+		char move = aStar(candidates[best].x, candidates[best].y);
+		if (move != 0) {
+			exploreX = candidates[best].x;
+			exploreY = candidates[best].y;
+			return move;
+		}
+		candidates.erase(candidates.begin() + best);
+		scores.erase(scores.begin() + best);
+	}
+	
 	return 0;
 }
 
@@ -579,7 +923,7 @@ char World::bomb(){
 	int highX = -1;
 	int highY = -1;
 	//iterates through all bomb positions evaluates the worth of blowing up
-	for (int j = seenYMax; j >= seenYMin; --j) {
+	for (int j = seenYMax; j >= seenYMin && !isCancelled(); --j) {
 		for (int i = seenXMin; i <= seenXMax; ++i) {
 			if ((getMap(i,j) == 'T' || getMap(i,j) == '*') && getAccess(i, j) == 1){
 				int kabooms = bombVal(i, j);
@@ -600,6 +944,12 @@ char World::bomb(){
 }
 
 //evaluates the worth of blowing up target tile
+int World::bombVal(int i, int j) {
+	if (hasAxe()) return bombVal<true>(i, j);
+	return bombVal<false>(i, j);
+}
+
+template <bool axe>
 int World::bombVal(int i,int j){
 	std::vector<Coord> closed;
 	std::queue<Coord> open;
@@ -613,7 +963,7 @@ int World::bombVal(int i,int j){
 	closed.push_back(current);
 	open.push(current);
 
-	while (!open.empty()) {
+	while (!open.empty() && !isCancelled()) {
 		current = open.front();
 		open.pop();
 		//if tile contains axe then evaluate all tree tiles
@@ -645,10 +995,9 @@ int World::bombVal(int i,int j){
 			char on = getMap(newX, newY);
 			char from = getMap(current.x, current.y);
 			//adds to queues if affected by removal of target tiles
+			const Transition &rule = transitions.get<axe>(from, on);
 			if (getAccess(newX, newY) > getAccess(current.x, current.y)
-				|| (getAccess(newX, newY) == getAccess(current.x, current.y) && 
-					((on == 'T' && hasAxe()) || on == ' ' || on == 'B' || on == 'a' || on == 'g' || on == 'd'))|| 
-					(on == '~' && (from == 'B' || from == '~')) ){ 
+				|| (getAccess(newX, newY) == getAccess(current.x, current.y) && rule.passable && rule.kabooms == 0)) {
 				Coord nextNode(newX, newY);
 				bool found = false;
 				for (std::vector<Coord>::iterator iter = closed.begin(); iter != closed.end(); ++iter) {
@@ -687,7 +1036,7 @@ int World::bombVal(int i,int j){
 
 //finds tiles of given type
 char World::findTile(char target) {
-	for (int j = seenYMax; j >= seenYMin; --j) {
+	for (int j = seenYMax; j >= seenYMin && !isCancelled(); --j) {
 		for (int i = seenXMin; i <= seenXMax; ++i) {
 			if (getMap(i,j) == target){
 				char move = aStar(i, j);
@@ -698,6 +1047,343 @@ char World::findTile(char target) {
 	return 0;
 }
 
+/*
+ * Random keys for hashing planner states
+ * A state's hash is the xor of the keys of its features, so transitions update it incrementally
+ */
+class Zobrist {
+	static uint64_t seed;
+	static uint64_t next();
+public:
+	static uint64_t position[world_size * world_size];
+	static uint64_t cleared[world_size * world_size]; // blasted obstacle or collected item
+	static uint64_t boatFrom[world_size * world_size];
+	static uint64_t boatAt[world_size * world_size];
+	static uint64_t kabooms[plan_max_kabooms + 1];
+	static uint64_t axe, gold;
+	static void init();
+};
+
+uint64_t Zobrist::seed = 0;
+uint64_t Zobrist::position[world_size * world_size];
+uint64_t Zobrist::cleared[world_size * world_size];
+uint64_t Zobrist::boatFrom[world_size * world_size];
+uint64_t Zobrist::boatAt[world_size * world_size];
+uint64_t Zobrist::kabooms[plan_max_kabooms + 1];
+uint64_t Zobrist::axe;
+uint64_t Zobrist::gold;
+
+// splitmix64, fixed seed so plans are reproducible
+uint64_t Zobrist::next() {
+	uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+void Zobrist::init() {
+	if (seed != 0) return;
+	for (int i = 0; i < world_size * world_size; ++i) {
+		position[i] = next();
+		cleared[i] = next();
+		boatFrom[i] = next();
+		boatAt[i] = next();
+	}
+	for (int i = 0; i <= plan_max_kabooms; ++i) {
+		kabooms[i] = next();
+	}
+	axe = next();
+	gold = next();
+}
+
+// Open addressing table from state hash to planner node
+class TranspositionTable {
+	std::vector<uint64_t> keys; // 0 = empty
+	std::vector<int> values;
+	int count;
+public:
+	TranspositionTable(int capacity) : keys(capacity, 0), values(capacity, -1), count(0) {}
+	int find(uint64_t key) const;
+	bool store(uint64_t key, int value);
+};
+
+int TranspositionTable::find(uint64_t key) const {
+	int mask = keys.size() - 1;
+	for (int i = key & mask; keys[i] != 0; i = (i + 1) & mask) {
+		if (keys[i] == key) return values[i];
+	}
+	return -1;
+}
+
+// returns false if the table is too full to add another key
+bool TranspositionTable::store(uint64_t key, int value) {
+	int mask = keys.size() - 1;
+	int i = key & mask;
+	for (; keys[i] != 0; i = (i + 1) & mask) {
+		if (keys[i] == key) {
+			values[i] = value;
+			return true;
+		}
+	}
+	if (count * 2 >= (int)keys.size()) return false;
+	keys[i] = key;
+	values[i] = value;
+	++count;
+	return true;
+}
+
+// Node of the global planner, positions are array indices (x * world_size + y)
+struct PlanNode {
+	int pos;
+	bool axe, gold;
+	int kabooms;
+	int boatFrom, boatAt; // original and current cell of a boat moved by the plan, -1 if none moved
+	std::vector<int> cleared; // blasted obstacles and collected items
+	uint64_t hash;
+	int cost, parent;
+	std::vector<PlanStep> steps; // steps taken from parent to reach this node
+};
+
+/*
+ * Searches for the cheapest sequence of pickups and blasts which collects the gold and returns to (0, 0)
+ * Each node's legs are costed by a dijkstra layered on the number of bombs used, so one search gives
+ * the distance to every item with 0, 1, 2... bombs. Repeated states are merged via the transposition table.
+ * Unknown tiles are treated as impassable, so the plan is valid on the known map alone.
+ */
+bool World::makePlan() {
+	plan.clear();
+	Zobrist::init();
+	
+	// region of the map which has been seen
+	int x0 = seenXMin + world_center;
+	int y0 = seenYMin + world_center;
+	int width = seenXMax - seenXMin + 1;
+	int height = seenYMax - seenYMin + 1;
+	int origin = world_center * world_size + world_center;
+	
+	std::vector<int> items;
+	int goldCell = -1;
+	for (int i = x0; i < x0 + width; ++i) {
+		for (int j = y0; j < y0 + height; ++j) {
+			if (map[i][j] == 'a' || map[i][j] == 'd' || map[i][j] == 'g') items.push_back(i * world_size + j);
+			if (map[i][j] == 'g') goldCell = i * world_size + j;
+		}
+	}
+	if (!hasGold() && goldCell == -1) return false;
+	
+	std::vector<PlanNode> nodes;
+	PlanNode root;
+	root.pos = (posX + world_center) * world_size + posY + world_center;
+	root.axe = hasAxe();
+	root.gold = hasGold();
+	root.kabooms = std::min(getKaboomCount(), plan_max_kabooms);
+	root.boatFrom = -1;
+	root.boatAt = -1;
+	root.hash = Zobrist::position[root.pos] ^ Zobrist::kabooms[root.kabooms] ^ (root.axe ? Zobrist::axe : 0) ^ (root.gold ? Zobrist::gold : 0);
+	root.cost = 0;
+	root.parent = -1;
+	nodes.push_back(root);
+	
+	TranspositionTable table(1 << 15);
+	table.store(root.hash, 0);
+	std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int> >, std::greater<std::pair<int, int> > > open;
+	open.push(std::make_pair(0, 0));
+	
+	std::vector<char> grid(width * height);
+	std::vector<int> dist, parent;
+	int expanded = 0;
+	while (!open.empty() && expanded < plan_max_states && !isCancelled()) {
+		int index = open.top().second;
+		open.pop();
+		
+		// skip nodes superseded by a cheaper path to the same state
+		if (table.find(nodes[index].hash) != index) continue;
+		++expanded;
+		
+		// Goal: back at the start with the gold
+		if (nodes[index].gold && nodes[index].pos == origin) {
+			for (int i = index; i != -1; i = nodes[i].parent) {
+				for (int j = nodes[i].steps.size() - 1; j >= 0; --j) {
+					plan.push_back(nodes[i].steps[j]);
+				}
+			}
+			return true;
+		}
+		
+		// copy of the map as this node sees it
+		PlanNode node = nodes[index];
+		for (int i = 0; i < width; ++i) {
+			for (int j = 0; j < height; ++j) {
+				grid[i * height + j] = map[x0 + i][y0 + j];
+			}
+		}
+		for (std::vector<int>::iterator iter = node.cleared.begin(); iter != node.cleared.end(); ++iter) {
+			grid[(*iter / world_size - x0) * height + *iter % world_size - y0] = ' ';
+		}
+		if (node.boatAt != -1) {
+			grid[(node.boatFrom / world_size - x0) * height + node.boatFrom % world_size - y0] = '~';
+			grid[(node.boatAt / world_size - x0) * height + node.boatAt % world_size - y0] = 'B';
+		}
+		
+		// dijkstra over (cell, bombs used), index = cell * layers + bombs
+		int layers = node.kabooms + 1;
+		dist.assign(width * height * layers, INT_MAX);
+		parent.assign(width * height * layers, -1);
+		std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int> >, std::greater<std::pair<int, int> > > fringe;
+		int start = ((node.pos / world_size - x0) * height + node.pos % world_size - y0) * layers;
+		dist[start] = 0;
+		fringe.push(std::make_pair(0, start));
+		while (!fringe.empty()) {
+			int cost = fringe.top().first;
+			int current = fringe.top().second;
+			fringe.pop();
+			if (cost > dist[current]) continue;
+			
+			int cell = current / layers;
+			int used = current % layers;
+			char currTile = grid[cell];
+			for (int i = 0; i < 4; ++i) {
+				int newX = cell / height + forwardX[i];
+				int newY = cell % height + forwardY[i];
+				if (newX < 0 || newX >= width || newY < 0 || newY >= height) continue;
+				int newCell = newX * height + newY;
+				char newTile = grid[newCell];
+				const Transition &rule = transitions.get(currTile, newTile, node.axe);
+				if (!rule.passable || used + rule.kabooms >= layers) continue;
+				int next = newCell * layers + used + rule.kabooms;
+				int step = rule.action ? 2 : 1; // chop or blast takes an extra move
+				if (cost + step < dist[next]) {
+					dist[next] = cost + step;
+					parent[next] = current;
+					fringe.push(std::make_pair(cost + step, next));
+				}
+			}
+		}
+		
+		// a leg to each remaining item (and home once holding the gold), for every number of bombs which shortens it
+		std::vector<int> targets;
+		for (std::vector<int>::iterator iter = items.begin(); iter != items.end(); ++iter) {
+			if (std::find(node.cleared.begin(), node.cleared.end(), *iter) == node.cleared.end()) targets.push_back(*iter);
+		}
+		if (node.gold) targets.push_back(origin);
+		for (std::vector<int>::iterator target = targets.begin(); target != targets.end(); ++target) {
+			int targetCell = (*target / world_size - x0) * height + *target % world_size - y0;
+			int best = INT_MAX;
+			for (int used = 0; used < layers; ++used) {
+				int cost = dist[targetCell * layers + used];
+				if (cost >= best) continue;
+				best = cost;
+				
+				// walk the leg backwards
+				std::vector<int> leg;
+				for (int i = targetCell * layers + used; i != start; i = parent[i]) leg.push_back(i);
+				std::reverse(leg.begin(), leg.end());
+				
+				PlanNode child = node;
+				child.cost = node.cost + cost;
+				child.parent = index;
+				child.steps.clear();
+				child.hash ^= Zobrist::position[child.pos] ^ Zobrist::kabooms[child.kabooms];
+				int boatCell = -1, lastWater = -1;
+				if (grid[start / layers] == 'B') boatCell = node.pos;
+				for (unsigned int i = 0; i < leg.size(); ++i) {
+					int cell = leg[i] / layers;
+					int arrayCell = (x0 + cell / height) * world_size + y0 + cell % height;
+					char tile = grid[cell];
+					PlanStep step = {true, x0 + cell / height - world_center, y0 + cell % height - world_center};
+					if (leg[i] % layers > (i == 0 ? 0 : leg[i - 1] % layers)) {
+						// blasted on the way
+						child.steps.push_back(step);
+						child.cleared.push_back(arrayCell);
+						child.hash ^= Zobrist::cleared[arrayCell];
+						--child.kabooms;
+					} else if (tile == 'a' || tile == 'd' || tile == 'g') {
+						// items are picked up by walking over them
+						child.cleared.push_back(arrayCell);
+						child.hash ^= Zobrist::cleared[arrayCell];
+						if (tile == 'a' && !child.axe) {
+							child.axe = true;
+							child.hash ^= Zobrist::axe;
+						} else if (tile == 'd' && child.kabooms < plan_max_kabooms) {
+							++child.kabooms;
+						} else if (tile == 'g' && !child.gold) {
+							child.gold = true;
+							child.hash ^= Zobrist::gold;
+						}
+					} else if (tile == 'B' && lastWater == -1) {
+						boatCell = arrayCell;
+					} else if (tile == '~' && boatCell != -1) {
+						lastWater = arrayCell;
+					}
+				}
+				
+				// a boat used on the leg is left at the last water tile
+				if (lastWater != -1) {
+					if (child.boatAt != -1) child.hash ^= Zobrist::boatFrom[child.boatFrom] ^ Zobrist::boatAt[child.boatAt];
+					if (child.boatAt != boatCell) child.boatFrom = boatCell;
+					child.boatAt = lastWater;
+					child.hash ^= Zobrist::boatFrom[child.boatFrom] ^ Zobrist::boatAt[child.boatAt];
+				}
+				
+				child.pos = *target;
+				child.hash ^= Zobrist::position[child.pos] ^ Zobrist::kabooms[child.kabooms];
+				PlanStep walk = {false, *target / world_size - world_center, *target % world_size - world_center};
+				child.steps.push_back(walk);
+				
+				// keep only the cheapest way to reach each state
+				int existing = table.find(child.hash);
+				if (existing != -1 && nodes[existing].cost <= child.cost) continue;
+				nodes.push_back(child);
+				if (!table.store(child.hash, nodes.size() - 1)) {
+					nodes.pop_back();
+					continue;
+				}
+				
+				// heuristic: straight to the gold (if needed) then home
+				int remaining = 0;
+				int at = child.pos;
+				if (!child.gold) {
+					remaining += abs(goldCell / world_size - at / world_size) + abs(goldCell % world_size - at % world_size);
+					at = goldCell;
+				}
+				remaining += abs(origin / world_size - at / world_size) + abs(origin % world_size - at % world_size);
+				open.push(std::make_pair(child.cost + remaining, nodes.size() - 1));
+			}
+		}
+	}
+	return false;
+}
+
+// Returns the next move of the global plan, replanning when the map has changed
+// If there is no plan, returns 0
+char World::followPlan() {
+	if (planDirty) {
+		planDirty = false;
+		makePlan();
+	}
+	while (!plan.empty()) {
+		PlanStep step = plan.back();
+		char move = 0;
+		if (step.blast) {
+			// obstacle already gone, or will be chopped on the way
+			if ((getMap(step.x, step.y) != '*' && getMap(step.x, step.y) != 'T') || (getMap(step.x, step.y) == 'T' && hasAxe())) {
+				plan.pop_back();
+				continue;
+			}
+			move = aStar(step.x, step.y, true);
+		} else {
+			if (posX == step.x && posY == step.y) {
+				plan.pop_back();
+				continue;
+			}
+			move = aStar(step.x, step.y);
+		}
+		if (move == 0) plan.clear();
+		return move;
+	}
+	return 0;
+}
+
 void World::print() const {
 	int arrayXMin = seenXMin + world_center;
 	int arrayXMax = seenXMax + world_center;
@@ -735,6 +1421,136 @@ void World::print() const {
 	printf("\n");
 }
 
+/*
+ * Incremental terminal renderer for watching games live
+ * Keeps the last frame drawn and only sends the cells which changed, positioned with ANSI escapes,
+ * in one write per frame. The frame is redrawn in full when the seen area grows.
+ */
+class Renderer {
+	int overlays; // render_access | render_frontier | render_path
+	int rows, cols, originX, originY; // layout of the last frame, origin is the top left map coordinate
+	std::vector<char> shown, frame;
+	std::string out;
+	int frames;
+	
+	char &cell(int row, int col) { return frame[row * cols + col]; }
+	void moveTo(int row, int col);
+public:
+	Renderer(int overlays);
+	void draw(const World &world);
+};
+
+Renderer::Renderer(int overlays) {
+	this->overlays = overlays;
+	rows = 0;
+	cols = 0;
+	originX = 0;
+	originY = 0;
+	frames = 0;
+}
+
+// ANSI cursor position, 1 based
+void Renderer::moveTo(int row, int col) {
+	char escape[24];
+	int length = snprintf(escape, sizeof(escape), "\x1b[%d;%dH", row + 1, col + 1);
+	out.append(escape, length);
+}
+
+void Renderer::draw(const World &world) {
+	int width = world.getSeenXMax() - world.getSeenXMin() + 1;
+	int height = world.getSeenYMax() - world.getSeenYMin() + 1;
+	
+	// layout: status line, then the map with the access map to its right
+	bool redraw = world.getSeenXMin() != originX || world.getSeenYMax() != originY || height + 1 != rows;
+	rows = height + 1;
+	cols = (overlays & render_access) ? width * 2 + 1 : width;
+	cols = std::max(cols, 48);
+	originX = world.getSeenXMin();
+	originY = world.getSeenYMax();
+	frame.assign(rows * cols, ' ');
+	
+	char status[64];
+	int length = snprintf(status, sizeof(status), "move %d  axe %c  kabooms %d  gold %c",
+		++frames, world.hasAxe() ? 'y' : 'n', world.getKaboomCount(), world.hasGold() ? 'y' : 'n');
+	std::copy(status, status + std::min(length, cols), frame.begin());
+	
+	for (int j = 0; j < height; ++j) {
+		for (int i = 0; i < width; ++i) {
+			int x = originX + i;
+			int y = originY - j;
+			char tile = world.getMap(x, y);
+			if ((overlays & render_frontier) && tile == ' ' && world.canAccess(x, y, 0) && !world.isExplored(x, y)) tile = '+';
+			cell(j + 1, i) = tile;
+			if (overlays & render_access) {
+				int access = world.getAccess(x, y);
+				cell(j + 1, width + 1 + i) = access == -1 ? 'X' : access ^ '0';
+			}
+		}
+	}
+	
+	// walk the cached path from the player
+	if (overlays & render_path) {
+		int x = world.getPositionX();
+		int y = world.getPositionY();
+		int direction = world.getDirection();
+		const std::vector<char> &path = world.getPlannedPath();
+		for (std::vector<char>::const_reverse_iterator iter = path.rbegin(); iter != path.rend(); ++iter) {
+			if (*iter == 'f' || *iter == 'F') {
+				x += World::forwardX[direction];
+				y += World::forwardY[direction];
+				if (x >= originX && x < originX + width && y <= originY && y > originY - height) cell(originY - y + 1, x - originX) = ':';
+			} else if (*iter == 'l' || *iter == 'L') {
+				direction = (direction + 3) % 4;
+			} else if (*iter == 'r' || *iter == 'R') {
+				direction = (direction + 1) % 4;
+			}
+		}
+	}
+	
+	const char arrows[4] = {'^', '>', 'v', '<'};
+	cell(originY - world.getPositionY() + 1, world.getPositionX() - originX) = arrows[world.getDirection()];
+	
+	// emit changed cells, runs on a row only need one cursor move
+	out.clear();
+	if (redraw || shown.size() != frame.size()) {
+		out.append("\x1b[2J");
+		shown.assign(frame.size(), 0);
+	}
+	for (int row = 0; row < rows; ++row) {
+		int next = -1; // column the cursor is already at
+		for (int col = 0; col < cols; ++col) {
+			char c = frame[row * cols + col];
+			if (shown[row * cols + col] == c) continue;
+			if (col != next) moveTo(row, col);
+			out.push_back(c);
+			shown[row * cols + col] = c;
+			next = col + 1;
+		}
+	}
+	moveTo(rows, 0);
+	fwrite(out.data(), 1, out.size(), stdout);
+	fflush(stdout);
+}
+
+// Stages of getAction in priority order, each returns 0 if it has no move
+enum Stage { stage_plan, stage_return, stage_interest, stage_explore, stage_bomb, stage_count };
+
+char runStage(World &world, int stage) {
+	switch (stage) {
+	case stage_plan:
+		return world.usesPlanner() ? world.followPlan() : 0;
+	case stage_return:
+		return world.hasGold() ? world.aStar(0,0) : 0;
+	case stage_interest:
+		return world.findInterest();
+	case stage_explore:
+		return world.explore();
+	default:
+		return world.bomb();
+		//BOOOOOOOOOOOOOOOOOMB
+	}
+}
+
 char getAction(World &world) {
 	//world.print();
 	
@@ -742,18 +1558,8 @@ char getAction(World &world) {
 	// If gold can be accessed by walking/boat, then access it and return gold
 	// Otherwise, explore via walking/boat, chop trees if possible
 	char move = 0;
-	if (world.hasGold()) {
-		move = world.aStar(0,0);
-	}
-	if (move == 0) {
-		move = world.findInterest();
-	}
-	if (move == 0){
-		move = world.explore();
-	}
-	if (move == 0){
-		move = world.bomb();
-		//BOOOOOOOOOOOOOOOOOMB
+	for (int stage = 0; stage < stage_count && move == 0; ++stage) {
+		move = runStage(world, stage);
 	}
 	// TODO
 	//getchar();
@@ -763,24 +1569,577 @@ char getAction(World &world) {
 	return move;
 }
 
+/*
+ * Runs getAction's stages at the same time on a small pool, each on its own copy of the world
+ * The highest priority stage with a move wins, and once any stage has a move every lower priority
+ * stage is cancelled. State which failed stages leave behind is carried over, so the move and the
+ * world afterwards are the same as getAction's.
+ */
+class StageRunner {
+	std::vector<World> copies;
+	char results[stage_count];
+	bool finished[stage_count];
+	std::atomic<bool> cancel[stage_count];
+	std::vector<std::thread> workers;
+	std::deque<int> tasks;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	bool stopping;
+	
+	void work();
+public:
+	StageRunner(int threads);
+	~StageRunner();
+	char decide(World &world);
+};
+
+StageRunner::StageRunner(int threads) : copies(stage_count) {
+	stopping = false;
+	for (int i = 0; i < threads; ++i) {
+		workers.push_back(std::thread(&StageRunner::work, this));
+	}
+}
+
+StageRunner::~StageRunner() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::vector<std::thread>::iterator iter = workers.begin(); iter != workers.end(); ++iter) {
+		iter->join();
+	}
+}
+
+void StageRunner::work() {
+	while (1) {
+		int stage;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (tasks.empty() && !stopping) wake.wait(guard);
+			if (tasks.empty()) return;
+			stage = tasks.front();
+			tasks.pop_front();
+		}
+		char move = cancel[stage].load() ? 0 : runStage(copies[stage], stage);
+		if (move != 0) {
+			for (int i = stage + 1; i < stage_count; ++i) cancel[i].store(true);
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			results[stage] = move;
+			finished[stage] = true;
+		}
+		done.notify_all();
+	}
+}
+
+char StageRunner::decide(World &world) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (int i = 0; i < stage_count; ++i) {
+			copies[i] = world;
+			copies[i].setCancel(&cancel[i]);
+			cancel[i].store(false);
+			finished[i] = false;
+			tasks.push_back(i);
+		}
+	}
+	wake.notify_all();
+	
+	// wait for every stage above the winner to fail, then for the cancelled ones to stop
+	int winner = stage_count - 1;
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		while (1) {
+			int stage = 0;
+			while (stage < stage_count && finished[stage] && results[stage] == 0) ++stage;
+			if (stage == stage_count) break;
+			if (finished[stage]) {
+				winner = stage;
+				break;
+			}
+			done.wait(guard);
+		}
+		for (int i = winner + 1; i < stage_count; ++i) cancel[i].store(true);
+		for (int i = 0; i < stage_count; ++i) {
+			while (!finished[i]) done.wait(guard);
+		}
+	}
+	
+	// failed planning replaces the plan, and failed exploring drops the target
+	if (winner > stage_plan) copies[winner].adoptPlan(copies[stage_plan]);
+	if (winner > stage_explore) copies[winner].adoptExploreTarget(copies[stage_explore]);
+	
+	char move = results[winner];
+	world = copies[winner];
+	world.setCancel(NULL);
+	world.move(move);
+	return move;
+}
+
+// Single-producer single-consumer hand-off of one value between threads, without locking
+template <typename T>
+class SpscSlot {
+	std::atomic<bool> full;
+	T value;
+public:
+	SpscSlot() : full(false) {}
+	
+	// producer only, returns false if the last value has not been taken yet
+	bool put(const T &value) {
+		if (full.load(std::memory_order_acquire)) return false;
+		this->value = value;
+		full.store(true, std::memory_order_release);
+		return true;
+	}
+	
+	// consumer only, returns false if there is no value
+	bool take(T &value) {
+		if (!full.load(std::memory_order_acquire)) return false;
+		value = this->value;
+		full.store(false, std::memory_order_release);
+		return true;
+	}
+};
+
+// spins on a slot, backing off to sleeping when it stays empty
+template <typename T>
+T waitFor(SpscSlot<T> &slot) {
+	T value;
+	for (int spins = 0; !slot.take(value); ++spins) {
+		if (spins < 1000) std::this_thread::yield();
+		else usleep(50);
+	}
+	return value;
+}
+
+/*
+ * Background planner for pipelined mode
+ * While the server processes a move, decides the following move on a copy of the world which
+ * assumes the next view reveals nothing new. The result is only used if that assumption holds.
+ * The worker sleeps between jobs, so it takes no time from planning in the foreground.
+ */
+class Speculator {
+	std::mutex lock;
+	std::condition_variable wake;
+	World *job;
+	SpscSlot<char> results;
+	
+	void run() {
+		while (1) {
+			World *world;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				while (job == NULL) wake.wait(guard);
+				world = job;
+				job = NULL;
+			}
+			char view[5][5];
+			world->predictView(view);
+			world->updateMap(view);
+			results.put(getAction(*world));
+		}
+	}
+public:
+	Speculator() : job(NULL) {}
+	void start() { std::thread(&Speculator::run, this).detach(); }
+	// world must not be touched until collect returns
+	void submit(World *world) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			job = world;
+		}
+		wake.notify_one();
+	}
+	char collect() { return waitFor(results); }
+};
+
+// One game connection in multi-game mode, with its own world and receive buffer
+struct Session {
+	int fd;
+	World world;
+	char received[24]; // view bytes read so far, without the centre
+	int count;
+	char view[5][5]; // complete view handed to a worker
+	bool finished;
+};
+
+/*
+ * Plays many games from one process
+ * The main thread waits on every connection with epoll and assembles views, then queues the session
+ * for a pool of workers which plan and send the move. A session is never queued twice at once, since
+ * the server only sends the next view after receiving the move.
+ */
+class GameServer {
+	std::vector<Session *> sessions;
+	std::vector<std::thread> workers;
+	std::deque<Session *> ready;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping;
+	
+	void work();
+	void receive(Session *session);
+public:
+	GameServer(int port, int games, bool planner);
+	~GameServer();
+	void run(int workerCount);
+};
+
+GameServer::GameServer(int port, int games, bool planner) {
+	stopping = false;
+	for (int i = 0; i < games; ++i) {
+		Session *session = new Session();
+		session->fd = tcpopen(port + i);
+		session->count = 0;
+		session->finished = false;
+		session->world.setPlanner(planner);
+		fcntl(session->fd, F_SETFL, fcntl(session->fd, F_GETFL) | O_NONBLOCK);
+		sessions.push_back(session);
+	}
+}
+
+GameServer::~GameServer() {
+	for (std::vector<Session *>::iterator iter = sessions.begin(); iter != sessions.end(); ++iter) {
+		delete *iter;
+	}
+}
+
+// plans queued sessions until the server stops
+void GameServer::work() {
+	while (1) {
+		Session *session;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (ready.empty() && !stopping) wake.wait(guard);
+			if (ready.empty()) return;
+			session = ready.front();
+			ready.pop_front();
+		}
+		session->world.updateMap(session->view);
+		char action = getAction(session->world);
+		while (write(session->fd, &action, 1) != 1 && (errno == EAGAIN || errno == EINTR)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+// reads what is available on a connection, queueing the session once a whole view has arrived
+void GameServer::receive(Session *session) {
+	while (1) {
+		int length = read(session->fd, session->received + session->count, 24 - session->count);
+		if (length <= 0) {
+			if (length == 0 || (errno != EAGAIN && errno != EINTR)) {
+				// game over
+				session->finished = true;
+				close(session->fd);
+			}
+			return;
+		}
+		session->count += length;
+		if (session->count < 24) continue;
+		
+		// scan 5-by-5 window around current location
+		int k = 0;
+		for (int i = 0; i < 5; ++i) {
+			for (int j = 0; j < 5; ++j) {
+				session->view[i][j] = (i == 2 && j == 2) ? '^' : session->received[k++];
+			}
+		}
+		session->count = 0;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			ready.push_back(session);
+		}
+		wake.notify_one();
+		return;
+	}
+}
+
+void GameServer::run(int workerCount) {
+	int poll = epoll_create1(0);
+	for (std::vector<Session *>::iterator iter = sessions.begin(); iter != sessions.end(); ++iter) {
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = *iter;
+		epoll_ctl(poll, EPOLL_CTL_ADD, (*iter)->fd, &event);
+	}
+	for (int i = 0; i < workerCount; ++i) {
+		workers.push_back(std::thread(&GameServer::work, this));
+	}
+	
+	int active = sessions.size();
+	struct epoll_event events[64];
+	while (active > 0) {
+		int count = epoll_wait(poll, events, 64, -1);
+		if (count < 0 && errno != EINTR) break;
+		for (int i = 0; i < count; ++i) {
+			Session *session = (Session *)events[i].data.ptr;
+			receive(session);
+			// closing the socket also removes it from epoll
+			if (session->finished) --active;
+		}
+	}
+	close(poll);
+	
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::vector<std::thread>::iterator iter = workers.begin(); iter != workers.end(); ++iter) {
+		iter->join();
+	}
+}
+
+// Outcome of one map in batch mode
+struct BatchResult {
+	std::string name;
+	const char *outcome;
+	int moves;
+	double p50, p99; // per move latency in microseconds
+	double seconds;
+};
+
+/*
+ * Plays every map in a directory in-process against the game rules, spread over a work-stealing pool
+ * Maps are dealt round robin to per-worker queues. A worker takes from the front of its own queue
+ * and, once that is empty, steals from the back of another's, so a few long maps do not leave the
+ * other cores idle at the end of a suite.
+ */
+class BatchRunner {
+	struct WorkQueue {
+		std::mutex lock;
+		std::deque<int> maps;
+	};
+	std::vector<std::string> maps;
+	std::vector<BatchResult> results;
+	std::vector<WorkQueue> queues;
+	bool planner;
+	int maxMoves;
+	
+	bool take(int worker, int &index);
+	void work(int worker);
+	void play(int index);
+public:
+	BatchRunner(const char *directory, bool planner, int maxMoves);
+	bool empty() const { return maps.empty(); }
+	void run(int workerCount);
+	void report(double seconds) const;
+};
+
+BatchRunner::BatchRunner(const char *directory, bool planner, int maxMoves) : planner(planner), maxMoves(maxMoves) {
+	DIR *dir = opendir(directory);
+	if (dir == NULL) return;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		std::string name = entry->d_name;
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, ".in") == 0) {
+			maps.push_back(std::string(directory) + "/" + name);
+		}
+	}
+	closedir(dir);
+	std::sort(maps.begin(), maps.end());
+	results.resize(maps.size());
+}
+
+// next map for a worker, its own queue first and then stolen from the others
+bool BatchRunner::take(int worker, int &index) {
+	for (unsigned int i = 0; i < queues.size(); ++i) {
+		WorkQueue &queue = queues[(worker + i) % queues.size()];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (queue.maps.empty()) continue;
+		if (i == 0) {
+			index = queue.maps.front();
+			queue.maps.pop_front();
+		} else {
+			index = queue.maps.back();
+			queue.maps.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+void BatchRunner::work(int worker) {
+	int index;
+	while (take(worker, index)) play(index);
+}
+
+// plays one map to the end, as the server would with the same move limit
+void BatchRunner::play(int index) {
+	BatchResult &result = results[index];
+	result.name = maps[index].substr(maps[index].rfind('/') + 1);
+	result.outcome = "exceeded";
+	result.moves = 0;
+	result.p50 = result.p99 = 0;
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Bounty bounty;
+	if (!bounty.readMap(maps[index].c_str())) {
+		result.outcome = "unreadable";
+		result.seconds = 0;
+		return;
+	}
+	World *world = new World(); // too large for a worker's stack
+	world->setPlanner(planner);
+	std::vector<double> latency;
+	char view[5][5];
+	for (int moves = 1; moves <= maxMoves; ++moves) {
+		bounty.getView(view);
+		view[2][2] = '^';
+		std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+		world->updateMap(view);
+		char action = getAction(*world);
+		latency.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - before).count());
+		bounty.apply(action);
+		result.moves = moves;
+		if (bounty.isWon()) {
+			result.outcome = "won";
+			break;
+		} else if (bounty.isLost()) {
+			result.outcome = "lost";
+			break;
+		}
+	}
+	delete world;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	if (!latency.empty()) {
+		std::vector<double>::iterator p50 = latency.begin() + (latency.size() - 1) / 2;
+		std::nth_element(latency.begin(), p50, latency.end());
+		result.p50 = *p50;
+		std::vector<double>::iterator p99 = latency.begin() + (latency.size() - 1) * 99 / 100;
+		std::nth_element(latency.begin(), p99, latency.end());
+		result.p99 = *p99;
+	}
+}
+
+void BatchRunner::run(int workerCount) {
+	workerCount = std::min(workerCount, (int)maps.size());
+	queues = std::vector<WorkQueue>(workerCount);
+	for (unsigned int i = 0; i < maps.size(); ++i) {
+		queues[i % workerCount].maps.push_back(i);
+	}
+	std::vector<std::thread> workers;
+	for (int i = 0; i < workerCount; ++i) {
+		workers.push_back(std::thread(&BatchRunner::work, this, i));
+	}
+	for (std::vector<std::thread>::iterator iter = workers.begin(); iter != workers.end(); ++iter) {
+		iter->join();
+	}
+}
+
+void BatchRunner::report(double seconds) const {
+	int won = 0, moves = 0;
+	double busy = 0;
+	printf("%-16s %-10s %6s %10s %10s %9s\n", "map", "result", "moves", "p50 (us)", "p99 (us)", "time (s)");
+	for (std::vector<BatchResult>::const_iterator iter = results.begin(); iter != results.end(); ++iter) {
+		printf("%-16s %-10s %6d %10.1f %10.1f %9.3f\n", iter->name.c_str(), iter->outcome, iter->moves, iter->p50, iter->p99, iter->seconds);
+		if (strcmp(iter->outcome, "won") == 0) ++won;
+		moves += iter->moves;
+		busy += iter->seconds;
+	}
+	printf("won %d of %d in %d moves, %.3f s of play in %.3f s wall time\n", won, (int)results.size(), moves, busy, seconds);
+}
+
 int main(int argc, char *argv[]) {
 	char action;
 	int sd;
 	int ch;
 	int i, j;
+	int port = 0;
+	int games = 1;
+	int maxMoves = 10000; // same default as the server
+	const char *batch = NULL;
+	int workerCount = std::max(1u, std::thread::hardware_concurrency());
+	bool planner = false;
+	bool pipelined = false;
+	bool concurrent = false;
+	int overlays = -1; // -1 = renderer off
+	bool pending = false; // whether the speculator is working on the next move
 	World world = World();
+	World ahead = World();
+	World *current = &world;
+	World *speculative = &ahead;
+	Speculator speculator;
 	
-	if (argc < 3) {
-		printf("Usage: %s -p port\n", argv[0] );
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-g") == 0) {
+			planner = true;
+			Zobrist::init(); // before any planning thread starts
+		} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			games = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			workerCount = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			batch = argv[++i];
+		} else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			maxMoves = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "-s") == 0) {
+			pipelined = true;
+		} else if (strcmp(argv[i], "-c") == 0) {
+			concurrent = true;
+		} else if (strcmp(argv[i], "-r") == 0) {
+			overlays = 0;
+			if (i + 1 < argc && argv[i + 1][0] != '-') {
+				for (char *c = argv[++i]; *c; ++c) {
+					if (*c == 'a') overlays |= render_access;
+					else if (*c == 'f') overlays |= render_frontier;
+					else if (*c == 'p') overlays |= render_path;
+				}
+			}
+		} else {
+			port = 0;
+			batch = NULL;
+			break;
+		}
+	}
+	if (port == 0 && batch == NULL) {
+		printf("Usage: %s -p port [-n games] [-w workers] [-g] [-s] [-c] [-r [afp]]\n", argv[0] );
+		printf("       %s -b directory [-m moves] [-w workers] [-g]\n", argv[0] );
+		printf("  -n  play several games at once, on consecutive ports starting at port\n");
+		printf("  -b  play every .in map in a directory in-process and report the results\n");
+		printf("  -m  move limit for -b, defaults to the server's 10000\n");
+		printf("  -w  planning threads for -n, -c or -b, defaults to one per core\n");
+		printf("  -g  plan item pickups and blasts globally before falling back to greedy search\n");
+		printf("  -s  speculatively plan the next move while waiting for the server\n");
+		printf("  -c  evaluate the decision stages of each move concurrently\n");
+		printf("  -r  render the map live, with overlays for (a)ccess, (f)rontier and planned (p)ath\n");
 		exit(1);
 	}
 	
+	if (batch != NULL) {
+		BatchRunner runner(batch, planner, maxMoves);
+		if (runner.empty()) {
+			printf("No maps found in %s\n", batch);
+			exit(1);
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		runner.run(workerCount);
+		runner.report(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		return 0;
+	}
+	
+	if (games > 1) {
+		GameServer server(port, games, planner);
+		server.run(workerCount);
+		return 0;
+	}
+	
 	// open socket to Game Engine
-	sd = tcpopen(atoi(argv[2]));
+	sd = tcpopen(port);
+	world.setPlanner(planner);
 	
-	pipe_fd    = sd;
-	in_stream  = fdopen(sd,"r");
-	out_stream = fdopen(sd,"w");
+	FILE *in_stream  = fdopen(sd,"r");
+	FILE *out_stream = fdopen(sd,"w");
+	
+	if (pipelined) speculator.start();
+	Renderer renderer(overlays);
+	StageRunner *runner = concurrent ? new StageRunner(std::min(workerCount, (int)stage_count)) : NULL;
 	
 	char view[5][5];
 	while (1) {
@@ -798,11 +2157,31 @@ int main(int argc, char *argv[]) {
 				}
 			}
 		}
-		world.updateMap(view);
 		
-		action = getAction(world);
+		bool stale = false; // speculation still running for a view which did not come
+		if (pending && current->matchesView(view)) {
+			// prediction held, the speculative world is already past this view
+			action = speculator.collect();
+			std::swap(current, speculative);
+		} else {
+			current->updateMap(view);
+			action = runner ? runner->decide(*current) : getAction(*current);
+			stale = pending;
+		}
+		pending = false;
+		
 		putc(action, out_stream);
 		fflush(out_stream);
+		// the wrong guess is only drained once the move is out, before its world is reused
+		if (stale) speculator.collect();
+		if (overlays != -1) renderer.draw(*current);
+		
+		// plan the next move while the server replies
+		if (pipelined) {
+			*speculative = *current;
+			speculator.submit(speculative);
+			pending = true;
+		}
 	}
 	return 0;
 }
@@ -0,0 +1,167 @@
+/*********************************************
+ *  bounty.cpp
+ *  Game rules for Text-Based Adventure Game, ported from Bounty.java
+ *  Behaviour matches the Java engine move for move
+*/
+
+#include <fstream>
+
+#include "bounty.h"
+
+#define EAST  0
+#define NORTH 1
+#define WEST  2
+#define SOUTH 3
+
+Bounty::Bounty() {
+	irow = icol = row = col = 0;
+	dirn = NORTH;
+	haveAxe = haveKey = haveGold = inBoat = offMap = false;
+	gameWon = gameLost = false;
+	dynamites = 0;
+}
+
+// reads rows up to the first empty line, returns false if the file cannot be read or has no agent
+bool Bounty::readMap(const char *mapName) {
+	std::ifstream in(mapName);
+	std::string line;
+	bool found = false;
+	map.clear();
+	while (std::getline(in, line) && !line.empty()) {
+		for (unsigned int c = 0; c < line.size(); ++c) {
+			bool agentHere = true;
+			switch (line[c]) {
+			case '^': dirn = NORTH; break;
+			case '>': dirn = EAST;  break;
+			case 'v': dirn = SOUTH; break;
+			case '<': dirn = WEST;  break;
+			default:  agentHere = false;
+			}
+			if (agentHere) {
+				row = map.size();
+				col = c;
+				found = true;
+			}
+		}
+		map.push_back(line);
+	}
+	irow = row;
+	icol = col;
+	return found;
+}
+
+// view in the agent's orientation, as the server sends it (the centre is left as the map has it)
+void Bounty::getView(char (&view)[5][5]) const {
+	int r = 0, c = 0;
+	for (int i = -2; i <= 2; ++i) {
+		for (int j = -2; j <= 2; ++j) {
+			switch (dirn) {
+			case NORTH: r = row + i; c = col + j; break;
+			case SOUTH: r = row - i; c = col - j; break;
+			case EAST:  r = row + j; c = col - i; break;
+			case WEST:  r = row - j; c = col + i; break;
+			}
+			if (r >= 0 && r < (int)map.size() && c >= 0 && c < (int)map[r].size()) {
+				view[2 + i][2 + j] = map[r][c];
+			} else {
+				view[2 + i][2 + j] = '.';
+			}
+		}
+	}
+}
+
+// returns false if the action had no effect
+bool Bounty::apply(char action) {
+	if (action == 'L' || action == 'l') {
+		dirn = (dirn + 1) % 4;
+		return true;
+	} else if (action == 'R' || action == 'r') {
+		dirn = (dirn + 3) % 4;
+		return true;
+	}
+	
+	int dRow = 0, dCol = 0;
+	switch (dirn) {
+	case NORTH: dRow = -1; break;
+	case SOUTH: dRow =  1; break;
+	case EAST:  dCol =  1; break;
+	case WEST:  dCol = -1; break;
+	}
+	int newRow = row + dRow;
+	int newCol = col + dCol;
+	
+	if (newRow < 0 || newRow >= (int)map.size() || newCol < 0 || newCol >= (int)map[newRow].size()) {
+		if (action == 'F' || action == 'f') {
+			if (!offMap) {
+				map[row][col] = '~';
+				offMap = true;
+			}
+			row = newRow;
+			col = newCol;
+			gameLost = true;
+			return true;
+		}
+		return false;
+	}
+	
+	char ch = map[newRow][newCol];
+	switch (action) {
+	case 'F': case 'f':
+		if (ch == '*' || ch == 'T' || ch == '-') return false; // can't move into an obstacle
+		if (!offMap) map[row][col] = ' ';
+		
+		switch (ch) {
+		case '~':
+			if (inBoat) {
+				if (!offMap) map[row][col] = '~';
+			} else {
+				gameLost = true;
+			}
+			break;
+		case ' ': case 'a': case 'k': case 'g': case 'd':
+			if (inBoat && !offMap) map[row][col] = 'B';
+			inBoat = false;
+			break;
+		case 'B':
+			if (inBoat && !offMap) map[row][col] = 'B';
+			inBoat = true;
+			break;
+		}
+		row = newRow;
+		col = newCol;
+		
+		switch (ch) {
+		case 'a': haveAxe  = true; break;
+		case 'k': haveKey  = true; break;
+		case 'g': haveGold = true; break;
+		case 'd': ++dynamites;     break;
+		}
+		if (haveGold && row == irow && col == icol) gameWon = true;
+		if (!offMap) map[row][col] = ' ';
+		offMap = false;
+		return true;
+		
+	case 'C': case 'c': // chop
+		if (ch == 'T' && haveAxe) {
+			map[newRow][newCol] = ' ';
+			return true;
+		}
+		break;
+		
+	case 'O': case 'o': // open
+		if (ch == '-' && haveKey) {
+			map[newRow][newCol] = ' ';
+			return true;
+		}
+		break;
+		
+	case 'B': case 'b': // blast
+		if (dynamites > 0 && (ch == '*' || ch == 'T' || ch == '-')) {
+			map[newRow][newCol] = ' ';
+			--dynamites;
+			return true;
+		}
+		break;
+	}
+	return false;
+}
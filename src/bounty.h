@@ -0,0 +1,29 @@
+/*********************************************
+ *  bounty.h
+ *  Game rules for Text-Based Adventure Game, ported from Bounty.java
+ *  Lets maps be played in-process, without a server
+*/
+
+#ifndef BOUNTY_H
+#define BOUNTY_H
+
+#include <string>
+#include <vector>
+
+class Bounty {
+	std::vector<std::string> map;
+	int irow, icol; // initial row and column
+	int row, col, dirn; // current row, column and direction of agent
+	bool haveAxe, haveKey, haveGold, inBoat, offMap;
+	bool gameWon, gameLost;
+	int dynamites;
+public:
+	Bounty();
+	bool readMap(const char *mapName);
+	void getView(char (&view)[5][5]) const;
+	bool apply(char action);
+	bool isWon() const { return gameWon; }
+	bool isLost() const { return gameLost; }
+};
+
+#endif